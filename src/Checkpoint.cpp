@@ -0,0 +1,132 @@
+#include "Checkpoint.h"
+
+#include <cstdio>
+#include <cinttypes>
+#include <stdexcept>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace video_syn {
+
+  CheckpointFile::CheckpointFile(const std::string &path, int interval)
+    : path(path), interval(interval) {
+  }
+
+  std::string CheckpointFile::makeJob(const char *tool,
+                                      const std::vector<const char *> &inputs,
+                                      const VideoEncoder::Config &config,
+                                      const std::string &options) {
+    std::string job = tool;
+    char buf[256];
+    for (const char *input : inputs) {
+      struct stat st;
+      if (stat(input, &st) < 0) {
+        throw std::runtime_error("could not stat input file");
+      }
+      snprintf(buf, sizeof(buf), " %lld:%lld:",
+               (long long)st.st_size,
+               (long long)st.st_mtime);
+      job += buf;
+      job += input;
+    }
+    snprintf(buf, sizeof(buf),
+             " %dx%d fmt=%d rate=%d tb=%d/%d gop=%d b=%d codec=%d closed=%d threads=%d ",
+             config.width,
+             config.height,
+             config.pix_fmt,
+             config.bit_rate,
+             config.time_base.num,
+             config.time_base.den,
+             config.gop_size,
+             config.max_b_frames,
+             config.codec_id,
+             config.closed_gop,
+             config.thread_count);
+    job += buf;
+    job += options;
+    return job;
+  }
+
+  bool CheckpointFile::load(const std::string &job, Checkpoint &checkpoint) {
+    FILE *pFile = fopen(path.c_str(), "r");
+    if (!pFile) {
+      return false;
+    }
+    char line[4096];
+    bool ok = fgets(line, sizeof(line), pFile) != nullptr;
+    if (ok) {
+      checkpoint.job = line;
+      if (!checkpoint.job.empty() && checkpoint.job.back() == '\n') {
+        checkpoint.job.pop_back();
+      }
+      ok = fscanf(pFile, "%" SCNd64 " %d %ld %d",
+                  &checkpoint.input_timestamp,
+                  &checkpoint.input_frames,
+                  &checkpoint.output_offset,
+                  &checkpoint.pts) == 4;
+    }
+    fclose(pFile);
+    return ok && checkpoint.job == job;
+  }
+
+  void CheckpointFile::save(const Checkpoint &checkpoint) {
+    std::string tmpPath = path + ".tmp";
+    FILE *pFile = fopen(tmpPath.c_str(), "w");
+    if (!pFile) {
+      throw std::runtime_error("could not write checkpoint");
+    }
+    fprintf(pFile, "%s\n%" PRId64 " %d %ld %d\n",
+            checkpoint.job.c_str(),
+            checkpoint.input_timestamp,
+            checkpoint.input_frames,
+            checkpoint.output_offset,
+            checkpoint.pts);
+    bool ok = fflush(pFile) == 0 && fsync(fileno(pFile)) == 0;
+    fclose(pFile);
+    // rename is atomic, so a kill mid-save leaves the previous checkpoint
+    if (!ok || rename(tmpPath.c_str(), path.c_str()) < 0) {
+      throw std::runtime_error("could not write checkpoint");
+    }
+  }
+
+  void CheckpointFile::remove() {
+    ::remove(path.c_str());
+  }
+
+  bool CheckpointFile::openEncoder(const char *outputFile,
+                                   const VideoEncoder::Config &config,
+                                   const std::string &job,
+                                   Checkpoint &checkpoint,
+                                   std::unique_ptr<VideoEncoder> &encoder) {
+    bool resume = load(job, checkpoint);
+    struct stat st;
+    if (resume && (stat(outputFile, &st) < 0 || st.st_size < checkpoint.output_offset)) {
+      fprintf(stderr, "output is shorter than its checkpoint, starting over\n");
+      resume = false;
+    }
+    if (resume) {
+      encoder.reset(new VideoEncoder(outputFile, config, checkpoint.output_offset));
+    } else {
+      // a stale checkpoint must not outlive the output it describes, or a
+      // later run of its job could resume on top of this one's bytes
+      remove();
+      encoder.reset(new VideoEncoder(outputFile, config));
+      checkpoint = { job, AV_NOPTS_VALUE, 0, 0, 0 };
+    }
+    return resume;
+  }
+
+  void CheckpointFile::frameDone(Checkpoint &checkpoint,
+                                 VideoEncoder &encoder,
+                                 VideoDecoder &decoder,
+                                 int pts) {
+    if (++checkpoint.input_frames % interval != 0) {
+      return;
+    }
+    checkpoint.output_offset = encoder.checkpoint();
+    checkpoint.input_timestamp = decoder.getLastTimestamp();
+    checkpoint.pts = pts;
+    save(checkpoint);
+  }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "VideoDecoder.h"
+#include "VideoEncoder.h"
+
+namespace video_syn {
+
+  // Progress of a long encode, recorded at a closed-GOP boundary.
+  struct Checkpoint {
+    std::string job;          // identifies the inputs, so stale files are ignored
+    int64_t input_timestamp;  // decoder timestamp of the last consumed frame
+    int input_frames;         // frames consumed from the input
+    long output_offset;       // output bytes up to and including the boundary
+    int pts;                  // pts of the next frame to encode
+  };
+
+  class CheckpointFile {
+
+  public:
+    CheckpointFile(const std::string &path, int interval);
+
+    // Describes a job by tool name, the path, size and mtime of each
+    // input, the encoder config and any tool options that affect the
+    // output, so a checkpoint is never resumed against different inputs.
+    static std::string makeJob(const char *tool,
+                               const std::vector<const char *> &inputs,
+                               const VideoEncoder::Config &config,
+                               const std::string &options);
+
+    // Returns false if there is no checkpoint for job.
+    bool load(const std::string &job, Checkpoint &checkpoint);
+
+    void save(const Checkpoint &checkpoint);
+
+    void remove();
+
+    // Reopens outputFile after the checkpoint for job, or starts it over
+    // when there is none or the output no longer holds all the bytes it
+    // covers. Returns whether it resumed; checkpoint tells where to go on.
+    bool openEncoder(const char *outputFile,
+                     const VideoEncoder::Config &config,
+                     const std::string &job,
+                     Checkpoint &checkpoint,
+                     std::unique_ptr<VideoEncoder> &encoder);
+
+    // Records one more input frame consumed, with pts the next pts to
+    // encode, and checkpoints every interval frames.
+    void frameDone(Checkpoint &checkpoint,
+                   VideoEncoder &encoder,
+                   VideoDecoder &decoder,
+                   int pts);
+
+  private:
+    std::string path;
+    int interval;
+  };
+
+}
@@ -0,0 +1,172 @@
+#include "FrameFingerprint.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+extern "C" {
+#include <libavutil/common.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static uint64_t sum_bytes(const uint8_t *p, int n) {
+  uint64_t sum = 0;
+  int i = 0;
+#ifdef __SSE2__
+  // psadbw against zero adds 8 bytes into each 64-bit lane per instruction
+  const __m128i zero = _mm_setzero_si128();
+  __m128i acc = zero;
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+    acc = _mm_add_epi64(acc, _mm_sad_epu8(v, zero));
+  }
+  sum = (uint64_t)_mm_cvtsi128_si32(acc) +
+    (uint64_t)_mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#endif
+  for (; i < n; i++) {
+    sum += p[i];
+  }
+  return sum;
+}
+
+// Number of rows and of bytes per row of one plane of pFrame.
+static void plane_size(const AVFrame *pFrame, int plane, int &rows, int &bytes) {
+  AVPixelFormat pixFmt = (AVPixelFormat)pFrame->format;
+  const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(pixFmt);
+  bool chroma = plane == 1 || plane == 2;
+  rows = chroma ? AV_CEIL_RSHIFT(pFrame->height, desc->log2_chroma_h) : pFrame->height;
+  bytes = av_image_get_linesize(pixFmt, pFrame->width, plane);
+}
+
+static void copy_samples(const AVFrame *pFrame, std::vector<uint8_t> &samples) {
+  samples.clear();
+  int planes = av_pix_fmt_count_planes((AVPixelFormat)pFrame->format);
+  for (int plane = 0; plane < planes; plane++) {
+    int rows, bytes;
+    plane_size(pFrame, plane, rows, bytes);
+    for (int y = 0; y < rows; y++) {
+      const uint8_t *row = pFrame->data[plane] + y * pFrame->linesize[plane];
+      samples.insert(samples.end(), row, row + bytes);
+    }
+  }
+}
+
+static bool same_samples(const AVFrame *pFrame, const std::vector<uint8_t> &samples) {
+  size_t offset = 0;
+  int planes = av_pix_fmt_count_planes((AVPixelFormat)pFrame->format);
+  for (int plane = 0; plane < planes; plane++) {
+    int rows, bytes;
+    plane_size(pFrame, plane, rows, bytes);
+    for (int y = 0; y < rows; y++) {
+      const uint8_t *row = pFrame->data[plane] + y * pFrame->linesize[plane];
+      if (offset + bytes > samples.size() ||
+          memcmp(row, &samples[offset], bytes) != 0) {
+        return false;
+      }
+      offset += bytes;
+    }
+  }
+  return offset == samples.size();
+}
+
+namespace video_syn {
+
+  void FrameFingerprint::compute(const AVFrame *pFrame) {
+    const int N = GRID;
+    AVPixelFormat pixFmt = (AVPixelFormat)pFrame->format;
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(pixFmt);
+    int planes = av_pix_fmt_count_planes(pixFmt);
+    if (!desc || planes <= 0) {
+      throw std::runtime_error("unsupported pixel format for fingerprint");
+    }
+
+    width = pFrame->width;
+    height = pFrame->height;
+    format = pFrame->format;
+    sums.assign(planes * N * N, 0);
+    counts.assign(planes * N * N, 0);
+
+    for (int plane = 0; plane < planes; plane++) {
+      int rows, bytes;
+      plane_size(pFrame, plane, rows, bytes);
+      uint64_t *planeSums = &sums[plane * N * N];
+      uint32_t *planeCounts = &counts[plane * N * N];
+      for (int y = 0; y < rows; y++) {
+        const uint8_t *row = pFrame->data[plane] + y * pFrame->linesize[plane];
+        int cy = (int64_t)y * N / rows;
+        for (int cx = 0; cx < N; cx++) {
+          int x0 = (int64_t)cx * bytes / N;
+          int x1 = (int64_t)(cx + 1) * bytes / N;
+          planeSums[cy * N + cx] += sum_bytes(row + x0, x1 - x0);
+          planeCounts[cy * N + cx] += x1 - x0;
+        }
+      }
+    }
+  }
+
+  double FrameFingerprint::distance(const FrameFingerprint &other) const {
+    if (width != other.width || height != other.height ||
+        format != other.format || sums.size() != other.sums.size()) {
+      return -1;
+    }
+    double worst = 0;
+    for (size_t i = 0; i < sums.size(); i++) {
+      if (counts[i] == 0) {
+        continue;
+      }
+      double diff = ((double)sums[i] - (double)other.sums[i]) / counts[i];
+      worst = std::max(worst, std::fabs(diff));
+    }
+    return worst;
+  }
+
+  const char *const RepeatDetector::USAGE =
+    "If repeat_threshold is given and not negative, frames whose block\n"
+    "means differ from the previous one by at most that much reuse the\n"
+    "previous output frame; 0 only matches bit-identical frames.\n";
+
+  RepeatDetector::RepeatDetector(double threshold) : threshold(threshold) {
+  }
+
+  bool RepeatDetector::isRepeat(const AVFrame *pFrame) {
+    if (threshold < 0) {
+      return false;
+    }
+    current.compute(pFrame);
+    bool repeat = false;
+    if (hasPrevious) {
+      double d = current.distance(previous);
+      repeat = d >= 0 && d <= threshold;
+    }
+    // equal cell sums do not make equal frames, e.g. a cursor moving
+    // within one cell; threshold 0 promises an exact match
+    if (threshold == 0) {
+      if (repeat) {
+        repeat = same_samples(pFrame, previousSamples);
+      }
+      if (!repeat) {
+        copy_samples(pFrame, previousSamples);
+      }
+    }
+    // a repeat reuses the last kept frame, so keep comparing against it;
+    // otherwise slow drift could go on for many frames unnoticed
+    if (!repeat) {
+      std::swap(previous, current);
+      hasPrevious = true;
+    } else {
+      repeats++;
+    }
+    return repeat;
+  }
+
+  int RepeatDetector::getRepeats() {
+    return repeats;
+  }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+namespace video_syn {
+
+  // Coarse signature of a decoded frame: the sum of the samples in each
+  // cell of a GRID x GRID grid, for every plane.
+  class FrameFingerprint {
+
+  public:
+    static const int GRID = 16;
+
+    void compute(const AVFrame *pFrame);
+
+    // Largest difference of the mean sample value over any cell, or a
+    // negative value if the frames have different layouts.
+    double distance(const FrameFingerprint &other) const;
+
+  private:
+    int width = 0;
+    int height = 0;
+    int format = -1;
+    std::vector<uint64_t> sums;
+    std::vector<uint32_t> counts;
+  };
+
+  // Tells whether each decoded frame repeats the last frame that was not a
+  // repeat, within threshold as measured by FrameFingerprint::distance. A
+  // threshold of 0 only accepts bit-identical frames, and a negative one
+  // turns detection off. Callers skip transforming a repeat and encode the
+  // previous output frame again, which the encoder codes as skipped
+  // macroblocks.
+  class RepeatDetector {
+
+  public:
+    // Usage text for the repeat_threshold command line argument.
+    static const char *const USAGE;
+
+    RepeatDetector(double threshold);
+
+    bool isRepeat(const AVFrame *pFrame);
+
+    int getRepeats();
+
+  private:
+    double threshold;
+    bool hasPrevious = false;
+    int repeats = 0;
+    FrameFingerprint previous;
+    FrameFingerprint current;
+    // samples of the previous frame, kept only for threshold 0
+    std::vector<uint8_t> previousSamples;
+  };
+
+}
@@ -0,0 +1,130 @@
+#include "ImageHeader.h"
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+static int read_u16(FILE *pFile) {
+  int hi = fgetc(pFile);
+  int lo = fgetc(pFile);
+  return hi < 0 || lo < 0 ? -1 : (hi << 8) | lo;
+}
+
+static bool read_jpeg(FILE *pFile, video_syn::ImageHeader &header) {
+  for (;;) {
+    int c = fgetc(pFile);
+    if (c != 0xff) {
+      return false;
+    }
+    int marker;
+    while ((marker = fgetc(pFile)) == 0xff) {
+    }
+    if (marker < 0 || marker == 0xd9 || marker == 0xda) {
+      // end of image or start of scan before any frame header
+      return false;
+    }
+    if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd8)) {
+      continue;
+    }
+    int length = read_u16(pFile);
+    if (length < 2) {
+      return false;
+    }
+    bool sof = marker >= 0xc0 && marker <= 0xcf &&
+      marker != 0xc4 && marker != 0xc8 && marker != 0xcc;
+    if (!sof) {
+      if (fseek(pFile, length - 2, SEEK_CUR) < 0) {
+        return false;
+      }
+      continue;
+    }
+
+    int precision = fgetc(pFile);
+    int height = read_u16(pFile);
+    int width = read_u16(pFile);
+    int components = fgetc(pFile);
+    if (precision <= 0 || height <= 0 || width <= 0 || components <= 0) {
+      return false;
+    }
+    int h[4], v[4], hMax = 1, vMax = 1;
+    for (int i = 0; i < components && i < 4; i++) {
+      fgetc(pFile); // component id
+      int sampling = fgetc(pFile);
+      fgetc(pFile); // quantization table
+      if (sampling < 0) {
+        return false;
+      }
+      h[i] = sampling >> 4 ? sampling >> 4 : 1;
+      v[i] = sampling & 15 ? sampling & 15 : 1;
+      hMax = h[i] > hMax ? h[i] : hMax;
+      vMax = v[i] > vMax ? v[i] : vMax;
+    }
+    double samples = 0;
+    for (int i = 0; i < components && i < 4; i++) {
+      samples += (double)(h[i] * v[i]) / (hMax * vMax);
+    }
+    bool lossless = marker == 0xc3 || marker == 0xc7 ||
+      marker == 0xcb || marker == 0xcf;
+    header.codec_id = AV_CODEC_ID_MJPEG;
+    header.width = width;
+    header.height = height;
+    header.bytes_per_pixel = samples * (precision > 8 ? 2 : 1);
+    // the MJPEG decoder does lowres for DCT-based JPEGs only
+    header.max_lowres = lossless ? 0 : 3;
+    return true;
+  }
+}
+
+static bool read_png(FILE *pFile, video_syn::ImageHeader &header) {
+  uint8_t ihdr[8 + 13];
+  if (fread(ihdr, 1, sizeof(ihdr), pFile) != sizeof(ihdr) ||
+      memcmp(ihdr + 4, "IHDR", 4) != 0) {
+    return false;
+  }
+  const uint8_t *p = ihdr + 8;
+  uint32_t width = (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+  uint32_t height = (uint32_t)p[4] << 24 | p[5] << 16 | p[6] << 8 | p[7];
+  int depth = p[8];
+  int colorType = p[9];
+  int channels;
+  switch (colorType) {
+  case 0: channels = 1; break; // gray
+  case 2: channels = 3; break; // rgb
+  case 3: channels = 1; break; // palette
+  case 4: channels = 2; break; // gray + alpha
+  case 6: channels = 4; break; // rgba
+  default: return false;
+  }
+  if (width == 0 || height == 0 || width > INT32_MAX || height > INT32_MAX) {
+    return false;
+  }
+  header.codec_id = AV_CODEC_ID_PNG;
+  header.width = width;
+  header.height = height;
+  header.bytes_per_pixel = channels * (depth == 16 ? 2 : 1);
+  header.max_lowres = 0;
+  return true;
+}
+
+namespace video_syn {
+
+  bool readImageHeader(const char *filename, ImageHeader &header) {
+    static const uint8_t PNG_SIGNATURE[8] = {
+      0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'
+    };
+    FILE *pFile = fopen(filename, "rb");
+    if (!pFile) {
+      return false;
+    }
+    uint8_t magic[8];
+    bool ok = false;
+    if (fread(magic, 1, 2, pFile) == 2 && magic[0] == 0xff && magic[1] == 0xd8) {
+      ok = read_jpeg(pFile, header);
+    } else if (fread(magic + 2, 1, 6, pFile) == 6 &&
+               memcmp(magic, PNG_SIGNATURE, 8) == 0) {
+      ok = read_png(pFile, header);
+    }
+    fclose(pFile);
+    return ok;
+  }
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+namespace video_syn {
+
+  // Size of a still image as read from its header, before any decoding.
+  struct ImageHeader {
+    AVCodecID codec_id;     // AV_CODEC_ID_MJPEG or AV_CODEC_ID_PNG
+    int width;
+    int height;
+    double bytes_per_pixel; // of the frame libavcodec decodes it to
+    int max_lowres;         // lowres levels libavcodec can decode it at
+  };
+
+  // Reads the SOF segment of a JPEG or the IHDR chunk of a PNG. Returns
+  // false for other formats or malformed headers.
+  bool readImageHeader(const char *filename, ImageHeader &header);
+
+}
@@ -0,0 +1,393 @@
+#include "ImageLoader.h"
+
+#include <algorithm>
+#include <csetjmp>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+#include <jpeglib.h>
+#include <png.h>
+
+#include "ImageHeader.h"
+#include "VideoDecoder.h"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libswscale/swscale.h>
+}
+
+// rows read from libjpeg or libpng per sws_scale call
+static const int BAND_ROWS = 64;
+static const int64_t DEFAULT_BUDGET_MB = 256;
+
+// Scales an image that arrives in bands of rows, top to bottom, into a
+// newly allocated output, so only one band of the source is ever in memory.
+struct BandScaler {
+  SwsContext *swsCtx;
+  AVFrame *pOutputFrame;
+  uint8_t *band;
+  int stride;
+  int y;
+};
+
+static void free_bands(BandScaler &scaler) {
+  sws_freeContext(scaler.swsCtx);
+  scaler.swsCtx = nullptr;
+  av_freep(&scaler.band);
+  if (scaler.pOutputFrame) {
+    av_freep(&scaler.pOutputFrame->data[0]);
+    av_frame_free(&scaler.pOutputFrame);
+  }
+}
+
+// Returns an error message, or nullptr once the scaler is ready for rows.
+static const char *start_bands(BandScaler &scaler,
+                               int srcWidth,
+                               int srcHeight,
+                               AVPixelFormat srcFmt,
+                               int channels,
+                               int width,
+                               int height,
+                               AVPixelFormat pixFmt,
+                               int64_t memoryBudget) {
+  scaler.stride = srcWidth * channels;
+  if (memoryBudget > 0 && (int64_t)scaler.stride * BAND_ROWS > memoryBudget) {
+    return "decoded rows would exceed the memory budget";
+  }
+  scaler.band = (uint8_t *)av_malloc((size_t)scaler.stride * BAND_ROWS);
+  if (!scaler.band) {
+    return "could not allocate the row buffer";
+  }
+  scaler.swsCtx = sws_getContext(srcWidth,
+                                 srcHeight,
+                                 srcFmt,
+                                 width,
+                                 height,
+                                 pixFmt,
+                                 SWS_BILINEAR,
+                                 nullptr,
+                                 nullptr,
+                                 nullptr);
+  if (!scaler.swsCtx) {
+    return "could not create the image scaler";
+  }
+  scaler.pOutputFrame = av_frame_alloc();
+  if (!scaler.pOutputFrame) {
+    return "could not allocate raw picture buffer";
+  }
+  scaler.pOutputFrame->format = pixFmt;
+  scaler.pOutputFrame->width = width;
+  scaler.pOutputFrame->height = height;
+  int ret = av_image_alloc(scaler.pOutputFrame->data,
+                           scaler.pOutputFrame->linesize,
+                           width,
+                           height,
+                           pixFmt,
+                           32);
+  if (ret < 0) {
+    return "could not allocate raw picture buffer";
+  }
+  scaler.y = 0;
+  return nullptr;
+}
+
+static void scale_band(BandScaler &scaler, int rows) {
+  const uint8_t *band[1] = { scaler.band };
+  sws_scale(scaler.swsCtx,
+            band,
+            &scaler.stride,
+            scaler.y,
+            rows,
+            scaler.pOutputFrame->data,
+            scaler.pOutputFrame->linesize);
+  scaler.y += rows;
+}
+
+// Hands the output over to the caller and frees everything else.
+static AVFrame *finish_bands(BandScaler &scaler) {
+  AVFrame *pOutputFrame = scaler.pOutputFrame;
+  scaler.pOutputFrame = nullptr;
+  free_bands(scaler);
+  return pOutputFrame;
+}
+
+struct JpegError {
+  jpeg_error_mgr pub;
+  jmp_buf jump;
+  char message[JMSG_LENGTH_MAX];
+};
+
+static void jpeg_error_exit(j_common_ptr cinfo) {
+  JpegError *err = (JpegError *)cinfo->err;
+  (*cinfo->err->format_message)(cinfo, err->message);
+  longjmp(err->jump, 1);
+}
+
+// Decodes a JPEG by scanline at the largest 1/2, 1/4 or 1/8 reduction that
+// still covers the output. Returns nullptr when libjpeg turns the file down
+// before any output exists (e.g. CMYK, or a progressive JPEG whose
+// coefficients exceed the budget), so the caller can fall back to FFmpeg.
+static AVFrame *load_jpeg(const char *filename,
+                          int width,
+                          int height,
+                          AVPixelFormat pixFmt,
+                          int64_t memoryBudget) {
+  FILE *pFile = fopen(filename, "rb");
+  if (!pFile) {
+    throw std::runtime_error("could not open image");
+  }
+  jpeg_decompress_struct cinfo;
+  JpegError err;
+  cinfo.err = jpeg_std_error(&err.pub);
+  err.pub.error_exit = jpeg_error_exit;
+  BandScaler scaler = {};
+  if (setjmp(err.jump)) {
+    bool started = scaler.pOutputFrame != nullptr;
+    free_bands(scaler);
+    jpeg_destroy_decompress(&cinfo);
+    fclose(pFile);
+    if (!started) {
+      return nullptr;
+    }
+    throw std::runtime_error(std::string("could not decode image: ") + err.message);
+  }
+  jpeg_create_decompress(&cinfo);
+  jpeg_stdio_src(&cinfo, pFile);
+  if (memoryBudget > 0) {
+    cinfo.mem->max_memory_to_use = memoryBudget;
+  }
+  jpeg_read_header(&cinfo, TRUE);
+
+  AVPixelFormat bandFmt;
+  if (cinfo.jpeg_color_space == JCS_GRAYSCALE) {
+    bandFmt = AV_PIX_FMT_GRAY8;
+  } else if (cinfo.jpeg_color_space == JCS_YCbCr || cinfo.jpeg_color_space == JCS_RGB) {
+    cinfo.out_color_space = JCS_RGB;
+    bandFmt = AV_PIX_FMT_RGB24;
+  } else {
+    jpeg_destroy_decompress(&cinfo);
+    fclose(pFile);
+    return nullptr;
+  }
+  for (unsigned int denom = 8; denom > 1; denom /= 2) {
+    if ((cinfo.image_width + denom - 1) / denom >= (unsigned int)width &&
+        (cinfo.image_height + denom - 1) / denom >= (unsigned int)height) {
+      cinfo.scale_num = 1;
+      cinfo.scale_denom = denom;
+      break;
+    }
+  }
+  jpeg_start_decompress(&cinfo);
+
+  const char *error = start_bands(scaler,
+                                  cinfo.output_width,
+                                  cinfo.output_height,
+                                  bandFmt,
+                                  cinfo.output_components,
+                                  width,
+                                  height,
+                                  pixFmt,
+                                  memoryBudget);
+  if (error) {
+    free_bands(scaler);
+    jpeg_destroy_decompress(&cinfo);
+    fclose(pFile);
+    throw std::runtime_error(error);
+  }
+  JSAMPROW rows[BAND_ROWS];
+  for (int i = 0; i < BAND_ROWS; i++) {
+    rows[i] = scaler.band + i * scaler.stride;
+  }
+  while (cinfo.output_scanline < cinfo.output_height) {
+    int count = std::min(BAND_ROWS, (int)(cinfo.output_height - cinfo.output_scanline));
+    int done = 0;
+    while (done < count) {
+      done += jpeg_read_scanlines(&cinfo, rows + done, count - done);
+    }
+    scale_band(scaler, count);
+  }
+  jpeg_finish_decompress(&cinfo);
+  jpeg_destroy_decompress(&cinfo);
+  fclose(pFile);
+  return finish_bands(scaler);
+}
+
+static void png_error_exit(png_structp png, png_const_charp message) {
+  std::string *err = (std::string *)png_get_error_ptr(png);
+  *err = message;
+  png_longjmp(png, 1);
+}
+
+// Decodes a PNG row by row, expanded to 8-bit gray, RGB or RGBA. Returns
+// nullptr for interlaced PNGs, whose rows are only complete after the last
+// pass, and when libpng turns the file down before any output exists.
+static AVFrame *load_png(const char *filename,
+                         int width,
+                         int height,
+                         AVPixelFormat pixFmt,
+                         int64_t memoryBudget) {
+  FILE *pFile = fopen(filename, "rb");
+  if (!pFile) {
+    throw std::runtime_error("could not open image");
+  }
+  std::string err;
+  png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING,
+                                           &err,
+                                           png_error_exit,
+                                           nullptr);
+  png_infop info = png ? png_create_info_struct(png) : nullptr;
+  if (!info) {
+    png_destroy_read_struct(&png, nullptr, nullptr);
+    fclose(pFile);
+    throw std::runtime_error("could not allocate the PNG reader");
+  }
+  BandScaler scaler = {};
+  if (setjmp(png_jmpbuf(png))) {
+    bool started = scaler.pOutputFrame != nullptr;
+    free_bands(scaler);
+    png_destroy_read_struct(&png, &info, nullptr);
+    fclose(pFile);
+    if (!started) {
+      return nullptr;
+    }
+    throw std::runtime_error("could not decode image: " + err);
+  }
+  png_init_io(png, pFile);
+  png_read_info(png, info);
+  if (png_get_interlace_type(png, info) != PNG_INTERLACE_NONE) {
+    png_destroy_read_struct(&png, &info, nullptr);
+    fclose(pFile);
+    return nullptr;
+  }
+  png_set_expand(png);
+  png_set_strip_16(png);
+  // sws has no gray + alpha input here, so such PNGs are read as RGBA
+  int colorType = png_get_color_type(png, info);
+  if (!(colorType & PNG_COLOR_MASK_COLOR) &&
+      ((colorType & PNG_COLOR_MASK_ALPHA) || png_get_valid(png, info, PNG_INFO_tRNS))) {
+    png_set_gray_to_rgb(png);
+  }
+  png_read_update_info(png, info);
+
+  int channels = png_get_channels(png, info);
+  AVPixelFormat bandFmt = channels == 1 ? AV_PIX_FMT_GRAY8 :
+    channels == 3 ? AV_PIX_FMT_RGB24 : AV_PIX_FMT_RGBA;
+  int srcHeight = png_get_image_height(png, info);
+  const char *error = start_bands(scaler,
+                                  png_get_image_width(png, info),
+                                  srcHeight,
+                                  bandFmt,
+                                  channels,
+                                  width,
+                                  height,
+                                  pixFmt,
+                                  memoryBudget);
+  if (error) {
+    free_bands(scaler);
+    png_destroy_read_struct(&png, &info, nullptr);
+    fclose(pFile);
+    throw std::runtime_error(error);
+  }
+  for (int y = 0; y < srcHeight; y += BAND_ROWS) {
+    int count = std::min(BAND_ROWS, srcHeight - y);
+    for (int i = 0; i < count; i++) {
+      png_read_row(png, scaler.band + i * scaler.stride, nullptr);
+    }
+    scale_band(scaler, count);
+  }
+  png_read_end(png, nullptr);
+  png_destroy_read_struct(&png, &info, nullptr);
+  fclose(pFile);
+  return finish_bands(scaler);
+}
+
+// Any format FFmpeg reads; the whole frame is decoded before scaling.
+static AVFrame *load_frame(const char *filename,
+                           int width,
+                           int height,
+                           AVPixelFormat pixFmt,
+                           int64_t memoryBudget) {
+  // the decoder owns the full-size frame, so it is freed when the
+  // decoder goes out of scope at the end of this function
+  video_syn::VideoDecoder decoder(filename, width, height, memoryBudget);
+  AVFrame *pInputFrame = av_frame_alloc();
+  if (!decoder.nextFrame(pInputFrame)) {
+    av_frame_free(&pInputFrame);
+    throw std::runtime_error("Expect a frame from input, but got nothing");
+  }
+
+  struct SwsContext *swsCtx;
+  swsCtx = sws_getContext(pInputFrame->width,
+                          pInputFrame->height,
+                          (AVPixelFormat)pInputFrame->format,
+                          width,
+                          height,
+                          pixFmt,
+                          SWS_BILINEAR,
+                          nullptr,
+                          nullptr,
+                          nullptr);
+  if (!swsCtx) {
+    av_frame_free(&pInputFrame);
+    throw std::runtime_error("could not create the image scaler");
+  }
+
+  AVFrame *pOutputFrame = av_frame_alloc();
+  pOutputFrame->format = pixFmt;
+  pOutputFrame->width = width;
+  pOutputFrame->height = height;
+  int ret = av_image_alloc(pOutputFrame->data,
+                           pOutputFrame->linesize,
+                           width,
+                           height,
+                           pixFmt,
+                           32);
+  if (ret < 0) {
+    av_frame_free(&pOutputFrame);
+    sws_freeContext(swsCtx);
+    av_frame_free(&pInputFrame);
+    throw std::runtime_error("could not allocate raw picture buffer");
+  }
+
+  sws_scale(swsCtx,
+            (uint8_t const * const *)pInputFrame->data,
+            pInputFrame->linesize,
+            0,
+            pInputFrame->height,
+            pOutputFrame->data,
+            pOutputFrame->linesize);
+  sws_freeContext(swsCtx);
+  av_frame_free(&pInputFrame);
+  return pOutputFrame;
+}
+
+namespace video_syn {
+
+  int64_t imageMemoryBudget() {
+    const char *value = getenv("VIDEO_SYN_IMAGE_BUDGET_MB");
+    int64_t mb = value ? atoll(value) : DEFAULT_BUDGET_MB;
+    return mb > 0 ? mb << 20 : 0;
+  }
+
+  AVFrame *loadImage(const char *filename,
+                     int width,
+                     int height,
+                     AVPixelFormat pixFmt,
+                     int64_t memoryBudget) {
+    ImageHeader header;
+    AVFrame *pOutputFrame = nullptr;
+    if (readImageHeader(filename, header)) {
+      if (header.codec_id == AV_CODEC_ID_MJPEG) {
+        pOutputFrame = load_jpeg(filename, width, height, pixFmt, memoryBudget);
+      } else if (header.codec_id == AV_CODEC_ID_PNG) {
+        pOutputFrame = load_png(filename, width, height, pixFmt, memoryBudget);
+      }
+    }
+    if (!pOutputFrame) {
+      pOutputFrame = load_frame(filename, width, height, pixFmt, memoryBudget);
+    }
+    return pOutputFrame;
+  }
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+namespace video_syn {
+
+  // Bytes allowed for decoding one still, from the VIDEO_SYN_IMAGE_BUDGET_MB
+  // environment variable (default 256). Caps libjpeg's working memory and
+  // the full frames FFmpeg decodes for other images; see VideoDecoder.
+  int64_t imageMemoryBudget();
+
+  // Decodes a still image and scales it to width x height in pixFmt.
+  // JPEGs are read by scanline, at 1/2, 1/4 or 1/8 size when that still
+  // covers the output, and non-interlaced PNGs row by row; each band of rows
+  // is scaled as it is read, so the full-size image is never in memory.
+  // Other images, and files libjpeg or libpng turn down, are decoded whole
+  // through FFmpeg. The result is allocated with av_image_alloc.
+  AVFrame *loadImage(const char *filename,
+                     int width,
+                     int height,
+                     AVPixelFormat pixFmt,
+                     int64_t memoryBudget);
+
+}
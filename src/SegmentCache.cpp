@@ -0,0 +1,103 @@
+#include "SegmentCache.h"
+
+#include <cstdio>
+#include <cstdint>
+#include <cerrno>
+#include <stdexcept>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+// bump when the segment layout or encoder setup changes
+static const int SEGMENT_VERSION = 3;
+
+static const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+static const uint64_t FNV_PRIME = 1099511628211ULL;
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t len) {
+  const uint8_t *p = (const uint8_t *)data;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= p[i];
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+static uint64_t fnv1a(uint64_t hash, int64_t value) {
+  return fnv1a(hash, &value, sizeof(value));
+}
+
+namespace video_syn {
+
+  SegmentCache::SegmentCache(const char *dir) : cacheDir(dir) {
+    if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+      throw std::runtime_error("could not create segment cache directory");
+    }
+  }
+
+  std::string SegmentCache::makeKey(const char *sourceFile,
+                                    const VideoEncoder::Config &config,
+                                    int frames,
+                                    int64_t imageBudget) {
+    FILE *pFile = fopen(sourceFile, "rb");
+    if (!pFile) {
+      throw std::runtime_error("could not open file to hash");
+    }
+    uint64_t contentHash = FNV_OFFSET;
+    uint8_t buf[1 << 16];
+    size_t len;
+    while ((len = fread(buf, 1, sizeof(buf), pFile)) > 0) {
+      contentHash = fnv1a(contentHash, buf, len);
+    }
+    fclose(pFile);
+
+    uint64_t configHash = FNV_OFFSET;
+    configHash = fnv1a(configHash, SEGMENT_VERSION);
+    configHash = fnv1a(configHash, config.width);
+    configHash = fnv1a(configHash, config.height);
+    configHash = fnv1a(configHash, config.pix_fmt);
+    configHash = fnv1a(configHash, config.bit_rate);
+    configHash = fnv1a(configHash, config.time_base.num);
+    configHash = fnv1a(configHash, config.time_base.den);
+    configHash = fnv1a(configHash, config.gop_size);
+    configHash = fnv1a(configHash, config.max_b_frames);
+    configHash = fnv1a(configHash, config.codec_id);
+    configHash = fnv1a(configHash, config.closed_gop);
+    configHash = fnv1a(configHash, config.thread_count);
+    configHash = fnv1a(configHash, frames);
+    configHash = fnv1a(configHash, imageBudget);
+
+    char key[40];
+    snprintf(key, sizeof(key), "%016llx-%016llx",
+             (unsigned long long)contentHash,
+             (unsigned long long)configHash);
+    return key;
+  }
+
+  std::string SegmentCache::get(const std::string &key,
+                                const std::function<void(const char *)> &producer) {
+    std::string path = cacheDir + "/" + key + ".seg";
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0 && st.st_size > 0 &&
+        access(path.c_str(), R_OK) == 0) {
+      return path;
+    }
+    std::string tmpPath = path + ".tmp." + std::to_string(getpid());
+    try {
+      producer(tmpPath.c_str());
+    } catch (...) {
+      remove(tmpPath.c_str());
+      throw;
+    }
+    if (stat(tmpPath.c_str(), &st) < 0 || st.st_size == 0) {
+      remove(tmpPath.c_str());
+      throw std::runtime_error("encoded segment is empty");
+    }
+    // rename is atomic, so concurrent jobs never see a partial segment
+    if (rename(tmpPath.c_str(), path.c_str()) < 0) {
+      remove(tmpPath.c_str());
+      throw std::runtime_error("could not store segment in cache");
+    }
+    return path;
+  }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include "VideoEncoder.h"
+
+namespace video_syn {
+
+  // On-disk cache of pre-encoded bitstream segments. A segment is encoded
+  // once and afterwards spliced into outputs with VideoEncoder::appendSegment.
+  class SegmentCache {
+
+  public:
+    SegmentCache(const char *cacheDir);
+
+    // Builds a key from the content of the source file, the encoder config,
+    // the number of frames in the segment and the memory budget the source
+    // image is decoded under, which picks its decoding resolution.
+    static std::string makeKey(const char *sourceFile,
+                               const VideoEncoder::Config &config,
+                               int frames,
+                               int64_t imageBudget);
+
+    // Returns the path of the segment for key. On a miss, producer is called
+    // with a temporary path to encode into, and must sync it to disk before
+    // returning; the result is then moved in place. Empty entries, e.g. left
+    // behind by a host crash, count as a miss.
+    std::string get(const std::string &key,
+                    const std::function<void(const char *)> &producer);
+
+  private:
+    std::string cacheDir;
+  };
+
+}
@@ -1,15 +1,108 @@
 #include "VideoDecoder.h"
 
+#include <climits>
+#include <functional>
 #include <stdexcept>
 #include <iostream>
+#include <vector>
+
+#include "ImageHeader.h"
+
+extern "C" {
+#include <libavutil/common.h>
+#include <libavutil/dict.h>
+#include <libavutil/imgutils.h>
+}
+
+static int64_t frame_bytes(AVPixelFormat pixFmt, int width, int height) {
+  int size = av_image_get_buffer_size(pixFmt, width, height, 1);
+  // unknown pixel format: assume 4 bytes per pixel
+  return size > 0 ? size : (int64_t)width * height * 4;
+}
+
+// Picks the highest lowres level that keeps the frame at least
+// minWidth x minHeight, going further if needed to fit maxFrameBytes.
+static int choose_lowres(int width,
+                         int height,
+                         int maxLowres,
+                         int minWidth,
+                         int minHeight,
+                         int64_t maxFrameBytes,
+                         const std::function<int64_t(int, int)> &bytes) {
+  int lowres = 0;
+  while (lowres < maxLowres) {
+    int w = AV_CEIL_RSHIFT(width, lowres + 1);
+    int h = AV_CEIL_RSHIFT(height, lowres + 1);
+    bool overBudget = maxFrameBytes > 0 &&
+      bytes(AV_CEIL_RSHIFT(width, lowres), AV_CEIL_RSHIFT(height, lowres)) > maxFrameBytes;
+    if (!overBudget && (w < minWidth || h < minHeight)) {
+      break;
+    }
+    lowres++;
+  }
+  if (maxFrameBytes > 0 &&
+      bytes(AV_CEIL_RSHIFT(width, lowres), AV_CEIL_RSHIFT(height, lowres)) > maxFrameBytes) {
+    throw std::runtime_error("decoded frame would exceed the memory budget");
+  }
+  return lowres;
+}
 
 namespace video_syn {
 
-  VideoDecoder::VideoDecoder(const char *mediaFilename) {
+  VideoDecoder::VideoDecoder(const char *mediaFilename)
+    : VideoDecoder(mediaFilename, INT_MAX, INT_MAX, 0) {
+  }
+
+  VideoDecoder::VideoDecoder(const char *mediaFilename,
+                             int minWidth,
+                             int minHeight,
+                             int64_t maxFrameBytes)
+    : filename(mediaFilename),
+      minWidth(minWidth),
+      minHeight(minHeight),
+      maxFrameBytes(maxFrameBytes) {
+    open();
+  }
+
+  void VideoDecoder::open() {
+    const char *mediaFilename = filename.c_str();
+    bool limited = minWidth != INT_MAX || minHeight != INT_MAX || maxFrameBytes > 0;
+
+    // avformat_find_stream_info decodes a frame of a still image to learn
+    // its size, so for JPEG and PNG the lowres level and the budget check
+    // come from the file header, before anything is decoded
+    ImageHeader header;
+    bool sized = limited && readImageHeader(mediaFilename, header);
+    int lowres = 0;
+    if (sized) {
+      lowres = choose_lowres(header.width,
+                             header.height,
+                             header.max_lowres,
+                             minWidth,
+                             minHeight,
+                             maxFrameBytes,
+                             [&](int w, int h) {
+                               return (int64_t)((double)w * h * header.bytes_per_pixel);
+                             });
+      decodedWidth = AV_CEIL_RSHIFT(header.width, lowres);
+      decodedHeight = AV_CEIL_RSHIFT(header.height, lowres);
+    }
+
     if (avformat_open_input(&pFormatCtx, mediaFilename, nullptr, nullptr)) {
       throw std::runtime_error("decoder could not open media file");
     }
-    if (avformat_find_stream_info(pFormatCtx, nullptr)<0) {
+    std::vector<AVDictionary *> streamOptions(pFormatCtx->nb_streams, nullptr);
+    if (lowres > 0) {
+      for (AVDictionary *&options : streamOptions) {
+        av_dict_set_int(&options, "lowres", lowres, 0);
+      }
+    }
+    int ret = avformat_find_stream_info(pFormatCtx,
+                                        streamOptions.empty() ? nullptr : streamOptions.data());
+    for (AVDictionary *&options : streamOptions) {
+      av_dict_free(&options);
+    }
+    if (ret < 0) {
       throw std::runtime_error("could not find stream information");
     }
     av_dump_format(pFormatCtx, 0, mediaFilename, 0);
@@ -30,6 +123,20 @@ namespace video_syn {
     if (pCodec == nullptr) {
       throw std::runtime_error("Unsuported codec!");
     }
+
+    if (limited && !sized) {
+      // other formats: only checked after probing
+      AVPixelFormat pixFmt = pCodecCtx->pix_fmt;
+      lowres = choose_lowres(pCodecCtx->width,
+                             pCodecCtx->height,
+                             pCodec->max_lowres,
+                             minWidth,
+                             minHeight,
+                             maxFrameBytes,
+                             [&](int w, int h) { return frame_bytes(pixFmt, w, h); });
+    }
+    pCodecCtx->lowres = lowres;
+
     if (avcodec_open2(pCodecCtx, pCodec, NULL) < 0) {
       throw std::runtime_error("Could not open input codec");
     }
@@ -51,21 +158,81 @@ namespace video_syn {
         if (len < 0) {
           throw std::runtime_error("Error while decoding frame");
         }
-        if (frameFinished) {
+        if (frameFinished && acceptFrame(pFrame)) {
           return true;
         }
       }
       av_free_packet(&packet);
     }
-    return false;
+
+    // end of input: drain the frames the decoder still holds, such as the
+    // last reference frame when B-frames are reordered
+    av_init_packet(&packet);
+    packet.data = nullptr;
+    packet.size = 0;
+    for (;;) {
+      len = avcodec_decode_video2(pCodecCtx,
+                                  pFrame,
+                                  &frameFinished,
+                                  &packet);
+      if (len < 0 || !frameFinished) {
+        return false;
+      }
+      if (acceptFrame(pFrame)) {
+        return true;
+      }
+    }
+  }
+
+  bool VideoDecoder::acceptFrame(AVFrame *pFrame) {
+    lastTimestamp = av_frame_get_best_effort_timestamp(pFrame);
+    if (skipThrough != AV_NOPTS_VALUE) {
+      if (lastTimestamp != AV_NOPTS_VALUE && lastTimestamp <= skipThrough) {
+        return false;
+      }
+      skipThrough = AV_NOPTS_VALUE;
+    }
+    return true;
+  }
+
+  void VideoDecoder::resume(int64_t timestamp, int frames) {
+    AVFrame *pFrame = av_frame_alloc();
+    bool seeked = false;
+    if (timestamp != AV_NOPTS_VALUE &&
+        av_seek_frame(pFormatCtx, videoStream, timestamp, AVSEEK_FLAG_BACKWARD) >= 0) {
+      avcodec_flush_buffers(pCodecCtx);
+      // an imprecise seek may land past the timestamp, which would
+      // silently drop the frames in between
+      if (nextFrame(pFrame) &&
+          lastTimestamp != AV_NOPTS_VALUE &&
+          lastTimestamp <= timestamp) {
+        skipThrough = timestamp;
+        seeked = true;
+      }
+    }
+    if (!seeked) {
+      close();
+      open();
+      for (int i = 0; i < frames; i++) {
+        if (!nextFrame(pFrame)) {
+          av_frame_free(&pFrame);
+          throw std::runtime_error("input is shorter than the checkpoint");
+        }
+      }
+    }
+    av_frame_free(&pFrame);
+  }
+
+  int64_t VideoDecoder::getLastTimestamp() {
+    return lastTimestamp;
   }
 
   int VideoDecoder::getWidth() {
-    return pCodecCtx->width;
+    return decodedWidth > 0 ? decodedWidth : pCodecCtx->width;
   }
 
   int VideoDecoder::getHeight() {
-    return pCodecCtx->height;
+    return decodedHeight > 0 ? decodedHeight : pCodecCtx->height;
   }
 
   AVPixelFormat VideoDecoder::getPixelFormat() {
@@ -76,8 +243,23 @@ namespace video_syn {
     return pFormatCtx->streams[videoStream]->time_base;
   }
 
-  VideoDecoder::~VideoDecoder() {
+  void VideoDecoder::close() {
+    if (started) {
+      av_free_packet(&packet);
+    }
     avcodec_close(pCodecCtx);
-    av_free(pCodecCtx);
+    // the codec context belongs to the stream and is freed with the input
+    avformat_close_input(&pFormatCtx);
+    pCodecCtx = nullptr;
+    pCodec = nullptr;
+    started = false;
+    lastTimestamp = AV_NOPTS_VALUE;
+    skipThrough = AV_NOPTS_VALUE;
+    decodedWidth = 0;
+    decodedHeight = 0;
+  }
+
+  VideoDecoder::~VideoDecoder() {
+    close();
   }
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <string>
+
 extern "C" {
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
@@ -12,6 +14,18 @@ namespace video_syn {
   public:
     VideoDecoder(const char *mediaFile);
 
+    // Decodes at a reduced resolution (libavcodec lowres) when the codec
+    // supports it: as far as the frame stays at least minWidth x minHeight,
+    // and further if needed to keep it within maxFrameBytes. Throws if the
+    // frame cannot be made to fit. A maxFrameBytes of 0 means no limit.
+    // For JPEG and PNG this is decided from the file header before any
+    // decoding; other formats are probed, which may decode a full frame,
+    // and are checked afterwards.
+    VideoDecoder(const char *mediaFile,
+                 int minWidth,
+                 int minHeight,
+                 int64_t maxFrameBytes);
+
     virtual ~VideoDecoder();
 
     VideoDecoder(const VideoDecoder&) = delete;
@@ -20,6 +34,18 @@ namespace video_syn {
 
     bool nextFrame(AVFrame *pFrame);
 
+    // Positions the decoder so that the next frame returned is the one
+    // after a frame already consumed by an earlier run, identified by its
+    // timestamp (as reported by getLastTimestamp) and by its index. Seeks
+    // when the timestamp is known and the seek provably lands at or before
+    // it; otherwise decodes the input again from the start and skips
+    // frames frames.
+    void resume(int64_t timestamp, int frames);
+
+    // Timestamp of the last frame returned by nextFrame, in getTimeBase units.
+    int64_t getLastTimestamp();
+
+    // Size of the decoded frames, after any lowres reduction.
     int getWidth();
 
     int getHeight();
@@ -29,12 +55,28 @@ namespace video_syn {
     AVRational getTimeBase();
 
   private:
+    void open();
+
+    // Records the timestamp of a decoded frame; false while resume() is
+    // still skipping frames up to its timestamp.
+    bool acceptFrame(AVFrame *pFrame);
+
+    void close();
+
+    std::string filename;
+    int minWidth;
+    int minHeight;
+    int64_t maxFrameBytes;
     AVCodec *pCodec = nullptr;
     AVFormatContext *pFormatCtx = nullptr;
     AVCodecContext *pCodecCtx = nullptr;
     AVPacket packet;
     int videoStream;
     bool started = false;
+    int64_t lastTimestamp = AV_NOPTS_VALUE;
+    int64_t skipThrough = AV_NOPTS_VALUE;
+    int decodedWidth = 0;  // from the image header, when known
+    int decodedHeight = 0;
   };
 
 }
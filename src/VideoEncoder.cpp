@@ -2,11 +2,49 @@
 
 #include <stdexcept>
 
+#include <sys/stat.h>
+#include <unistd.h>
+
 static uint8_t endcode[] = { 0, 0, 1, 0xb7 };
 
 namespace video_syn {
 
-  VideoEncoder::VideoEncoder(const char *filename, const Config &config) {
+  VideoEncoder::VideoEncoder(const char *filename, const Config &config)
+    : config(config) {
+    openCodec();
+
+    pFile = fopen(filename, "wb");
+    if (!pFile) {
+      throw std::runtime_error("Could not open file ");
+    }
+  }
+
+  VideoEncoder::VideoEncoder(const char *filename,
+                             const Config &config,
+                             long resumeOffset)
+    : config(config) {
+    openCodec();
+
+    pFile = fopen(filename, "r+b");
+    if (!pFile) {
+      throw std::runtime_error("Could not open file to resume");
+    }
+    // never let ftruncate pad a short output with zeros
+    struct stat st;
+    if (fstat(fileno(pFile), &st) < 0 || st.st_size < resumeOffset) {
+      fclose(pFile);
+      throw std::runtime_error("output is shorter than the checkpoint");
+    }
+    if (ftruncate(fileno(pFile), resumeOffset) < 0 ||
+        fseek(pFile, resumeOffset, SEEK_SET) < 0) {
+      fclose(pFile);
+      throw std::runtime_error("Could not truncate file to checkpoint");
+    }
+    started = true;
+  }
+
+  void VideoEncoder::openCodec() {
+    pCodec = nullptr;
     pCodecCtx = avcodec_alloc_context3(pCodec);
     if (!pCodecCtx) {
       throw std::runtime_error("Could not allocate video codec context");
@@ -18,6 +56,12 @@ namespace video_syn {
     pCodecCtx->gop_size = config.gop_size;
     pCodecCtx->max_b_frames = config.max_b_frames;
     pCodecCtx->pix_fmt = config.pix_fmt;
+    if (config.closed_gop) {
+      pCodecCtx->flags |= AV_CODEC_FLAG_CLOSED_GOP;
+    }
+    if (config.thread_count > 0) {
+      pCodecCtx->thread_count = config.thread_count;
+    }
 
     pCodec = avcodec_find_encoder(config.codec_id);
     if (!pCodec) {
@@ -26,11 +70,6 @@ namespace video_syn {
     if (avcodec_open2(pCodecCtx, pCodec, NULL) < 0) {
       throw std::runtime_error("Could not open output codec");
     }
-
-    pFile = fopen(filename, "wb");
-    if (!pFile) {
-      throw std::runtime_error("Could not open file ");
-    }
   }
 
   VideoEncoder::~VideoEncoder() {
@@ -42,6 +81,7 @@ namespace video_syn {
     if (finished) {
       throw std::runtime_error("encoder already finished");
     }
+    started = true;
     av_init_packet(&packet);
     packet.data = NULL;
     packet.size = 0;
@@ -60,7 +100,29 @@ namespace video_syn {
     }
   }
 
-  void VideoEncoder::finish() {
+  void VideoEncoder::appendSegment(const char *segmentFile) {
+    if (finished) {
+      throw std::runtime_error("encoder already finished");
+    }
+    if (started) {
+      throw std::runtime_error("segment must be appended before encoding frames");
+    }
+    FILE *pSegment = fopen(segmentFile, "rb");
+    if (!pSegment) {
+      throw std::runtime_error("Could not open segment file");
+    }
+    uint8_t buf[1 << 16];
+    size_t len;
+    while ((len = fread(buf, 1, sizeof(buf), pSegment)) > 0) {
+      fwrite(buf, 1, len, pFile);
+    }
+    fclose(pSegment);
+  }
+
+  void VideoEncoder::flush() {
+    if (finished) {
+      throw std::runtime_error("encoder already finished");
+    }
     for (int gotOutput = 1; gotOutput; ) {
       av_init_packet(&packet);
       packet.data = NULL;
@@ -77,7 +139,37 @@ namespace video_syn {
         av_packet_unref(&packet);
       }
     }
-    fwrite(endcode, 1, sizeof(endcode), pFile);
+  }
+
+  long VideoEncoder::checkpoint() {
+    flush();
+    avcodec_close(pCodecCtx);
+    av_free(pCodecCtx);
+    openCodec();
+
+    if (fflush(pFile) != 0 || fsync(fileno(pFile)) < 0) {
+      throw std::runtime_error("Could not sync output file");
+    }
+    return ftell(pFile);
+  }
+
+  void VideoEncoder::finish() {
+    flush();
+    // the sequence end code only exists in MPEG-1/2 streams
+    if (config.codec_id == AV_CODEC_ID_MPEG1VIDEO ||
+        config.codec_id == AV_CODEC_ID_MPEG2VIDEO) {
+      fwrite(endcode, 1, sizeof(endcode), pFile);
+    }
+    fclose(pFile);
+    finished = true;
+  }
+
+  void VideoEncoder::finishSegment() {
+    flush();
+    // segments are cached and reused, so make sure they are on disk
+    if (fflush(pFile) != 0 || fsync(fileno(pFile)) < 0) {
+      throw std::runtime_error("Could not sync segment file");
+    }
     fclose(pFile);
     finished = true;
   }
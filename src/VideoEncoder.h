@@ -12,6 +12,10 @@ namespace video_syn {
     struct Config;
     VideoEncoder(const char *filename, const Config &config);
 
+    // Reopens an output written by a previous run, truncated to
+    // resumeOffset as returned by checkpoint().
+    VideoEncoder(const char *filename, const Config &config, long resumeOffset);
+
     virtual ~VideoEncoder();
 
     VideoEncoder(const VideoEncoder&) = delete;
@@ -22,7 +26,26 @@ namespace video_syn {
 
     void finish();
 
+    // Flushes the encoder without writing the sequence end code, so the
+    // output can later be spliced in front of another stream, and syncs
+    // the output to disk.
+    void finishSegment();
+
+    // Copies a previously encoded segment into the output. Only valid
+    // before the first frame is encoded.
+    void appendSegment(const char *segmentFile);
+
+    // Drains the encoder so the output ends on a closed GOP, syncs it to
+    // disk and restarts the codec. Returns the output byte offset that a
+    // resumed run can truncate to.
+    long checkpoint();
+
   private:
+    void openCodec();
+
+    void flush();
+
+    bool started = false;
     bool finished = false;
     AVPacket packet;
     AVCodec *pCodec = nullptr;
@@ -39,7 +62,12 @@ namespace video_syn {
       int gop_size;
       int max_b_frames;
       AVCodecID codec_id;
+      bool closed_gop;
+      int thread_count; // 0 keeps the codec default
     };
+
+  private:
+    Config config;
   };
 
 }
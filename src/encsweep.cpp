@@ -0,0 +1,279 @@
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <cstdint>
+#include <cmath>
+#include <chrono>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "VideoDecoder.h"
+#include "VideoEncoder.h"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/common.h>
+#include <libswscale/swscale.h>
+}
+
+const int FPS = 25;
+const int WIDTH = 640;
+const int HEIGHT = 480;
+const int DEFAULT_MAX_FRAMES = 100;
+const char *OUTPUT_FILENAME = "encsweep.tmp";
+
+const int BIT_RATES[] = { 200000, 400000, 800000, 1600000 };
+const int GOP_SIZES[] = { 10, 25, 50 };
+const int MAX_B_FRAMES[] = { 0, 1, 2 };
+const AVCodecID CODEC_IDS[] = {
+  AV_CODEC_ID_MPEG1VIDEO,
+  AV_CODEC_ID_MPEG2VIDEO,
+  AV_CODEC_ID_MPEG4,
+};
+const int THREAD_COUNTS[] = { 1, 2, 4 };
+
+using namespace video_syn;
+
+struct Result {
+  VideoEncoder::Config config;
+  double fps;
+  long size;
+  double psnr;
+  double ssim;
+};
+
+AVFrame *initFrame(int width, int height) {
+  AVFrame *pFrame = av_frame_alloc();
+  pFrame->format = AV_PIX_FMT_YUV420P;
+  pFrame->width = width;
+  pFrame->height = height;
+  int ret = av_image_alloc(pFrame->data,
+                           pFrame->linesize,
+                           pFrame->width,
+                           pFrame->height,
+                           AV_PIX_FMT_YUV420P,
+                           32);
+  if (ret < 0) {
+    throw std::runtime_error("could not allocate raw picture buffer");
+  }
+  return pFrame;
+}
+
+// Decodes up to maxFrames of the clip, scaled to the sweep resolution, so
+// every run encodes exactly the same input.
+std::vector<AVFrame *> load_clip(const char *vidFile, int maxFrames) {
+  VideoDecoder decoder(vidFile);
+  struct SwsContext *swsCtx;
+  swsCtx = sws_getContext(decoder.getWidth(),
+                          decoder.getHeight(),
+                          decoder.getPixelFormat(),
+                          WIDTH,
+                          HEIGHT,
+                          AV_PIX_FMT_YUV420P,
+                          SWS_BILINEAR,
+                          nullptr,
+                          nullptr,
+                          nullptr);
+
+  std::vector<AVFrame *> frames;
+  AVFrame *pInputFrame = av_frame_alloc();
+  while ((int)frames.size() < maxFrames && decoder.nextFrame(pInputFrame)) {
+    AVFrame *pOutputFrame = initFrame(WIDTH, HEIGHT);
+    sws_scale(swsCtx,
+              (uint8_t const * const *)pInputFrame->data,
+              pInputFrame->linesize,
+              0,
+              decoder.getHeight(),
+              pOutputFrame->data,
+              pOutputFrame->linesize);
+    frames.push_back(pOutputFrame);
+  }
+  sws_freeContext(swsCtx);
+  av_free(pInputFrame);
+  if (frames.empty()) {
+    throw std::runtime_error("Expect a frame from input, but got nothing");
+  }
+  return frames;
+}
+
+double encode_clip(const std::vector<AVFrame *> &frames,
+                   const VideoEncoder::Config &config) {
+  auto start = std::chrono::steady_clock::now();
+  VideoEncoder encoder(OUTPUT_FILENAME, config);
+  for (size_t i = 0; i < frames.size(); i++) {
+    frames[i]->pts = i;
+    encoder.encodeFrame(frames[i]);
+  }
+  encoder.finish();
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return frames.size() / elapsed.count();
+}
+
+// SSIM of the luma plane over non-overlapping 8x8 windows.
+double luma_ssim(const AVFrame *a, const AVFrame *b) {
+  const double C1 = (0.01 * 255) * (0.01 * 255);
+  const double C2 = (0.03 * 255) * (0.03 * 255);
+  const int N = 8;
+  double total = 0;
+  int windows = 0;
+  for (int by = 0; by + N <= HEIGHT; by += N) {
+    for (int bx = 0; bx + N <= WIDTH; bx += N) {
+      double sa = 0, sb = 0, saa = 0, sbb = 0, sab = 0;
+      for (int y = by; y < by + N; y++) {
+        const uint8_t *pa = a->data[0] + y * a->linesize[0];
+        const uint8_t *pb = b->data[0] + y * b->linesize[0];
+        for (int x = bx; x < bx + N; x++) {
+          sa += pa[x];
+          sb += pb[x];
+          saa += pa[x] * pa[x];
+          sbb += pb[x] * pb[x];
+          sab += pa[x] * pb[x];
+        }
+      }
+      double n = N * N;
+      double ma = sa / n, mb = sb / n;
+      double va = saa / n - ma * ma;
+      double vb = sbb / n - mb * mb;
+      double cov = sab / n - ma * mb;
+      total += ((2 * ma * mb + C1) * (2 * cov + C2)) /
+        ((ma * ma + mb * mb + C1) * (va + vb + C2));
+      windows++;
+    }
+  }
+  return total / windows;
+}
+
+// Decodes the encoded output and compares its luma against the source clip.
+// Every run must decode to the full clip so rows compare the same frames.
+void measure_quality(const std::vector<AVFrame *> &frames, Result &result) {
+  VideoDecoder decoder(OUTPUT_FILENAME);
+  if (decoder.getPixelFormat() != AV_PIX_FMT_YUV420P) {
+    throw std::runtime_error("unexpected pixel format in encoded output");
+  }
+  AVFrame *pFrame = av_frame_alloc();
+  double sse = 0, ssim = 0;
+  size_t n = 0;
+  while (n < frames.size() && decoder.nextFrame(pFrame)) {
+    const AVFrame *pSource = frames[n];
+    for (int y = 0; y < HEIGHT; y++) {
+      const uint8_t *pa = pSource->data[0] + y * pSource->linesize[0];
+      const uint8_t *pb = pFrame->data[0] + y * pFrame->linesize[0];
+      for (int x = 0; x < WIDTH; x++) {
+        int d = pa[x] - pb[x];
+        sse += d * d;
+      }
+    }
+    ssim += luma_ssim(pSource, pFrame);
+    n++;
+  }
+  av_free(pFrame);
+  if (n != frames.size()) {
+    throw std::runtime_error("encoded output decoded to fewer frames than the clip");
+  }
+  double mse = sse / ((double)n * WIDTH * HEIGHT);
+  result.psnr = mse > 0 ? 10 * log10(255.0 * 255.0 / mse) : 99.0;
+  result.ssim = ssim / n;
+}
+
+// a dominates b if it is at least as fast, as good and as small, and
+// strictly better in one of them.
+bool dominates(const Result &a, const Result &b) {
+  bool noWorse = a.fps >= b.fps && a.psnr >= b.psnr && a.size <= b.size;
+  bool better = a.fps > b.fps || a.psnr > b.psnr || a.size < b.size;
+  return noWorse && better;
+}
+
+void print_result(const Result &r) {
+  printf("%-12s %8d %4d %3d %3d %9.1f %10ld %7.2f %6.4f\n",
+         avcodec_find_encoder(r.config.codec_id)->name,
+         r.config.bit_rate,
+         r.config.gop_size,
+         r.config.max_b_frames,
+         r.config.thread_count,
+         r.fps,
+         r.size,
+         r.psnr,
+         r.ssim);
+}
+
+void print_header() {
+  printf("%-12s %8s %4s %3s %3s %9s %10s %7s %6s\n",
+         "codec", "bitrate", "gop", "b", "thr", "fps", "bytes", "psnr", "ssim");
+}
+
+void sweep(const char *vidFilename, int maxFrames) {
+  std::vector<AVFrame *> frames = load_clip(vidFilename, maxFrames);
+  std::vector<Result> results;
+
+  print_header();
+  for (AVCodecID codecId : CODEC_IDS) {
+    for (int bitRate : BIT_RATES) {
+      for (int gopSize : GOP_SIZES) {
+        for (int maxBFrames : MAX_B_FRAMES) {
+          for (int threadCount : THREAD_COUNTS) {
+            Result result;
+            result.config = {
+              .width = WIDTH,
+              .height = HEIGHT,
+              .pix_fmt = AV_PIX_FMT_YUV420P,
+              .bit_rate = bitRate,
+              .time_base = (AVRational){1, FPS},
+              .gop_size = gopSize,
+              .max_b_frames = maxBFrames,
+              .codec_id = codecId,
+              .closed_gop = false,
+              .thread_count = threadCount,
+            };
+            result.fps = encode_clip(frames, result.config);
+            struct stat st;
+            if (stat(OUTPUT_FILENAME, &st) < 0) {
+              throw std::runtime_error("could not stat encoded output");
+            }
+            result.size = st.st_size;
+            measure_quality(frames, result);
+            print_result(result);
+            results.push_back(result);
+          }
+        }
+      }
+    }
+  }
+  remove(OUTPUT_FILENAME);
+
+  printf("\nPareto frontier (fps, psnr, bytes) over %zu frames:\n", frames.size());
+  print_header();
+  for (const Result &candidate : results) {
+    bool dominated = false;
+    for (const Result &other : results) {
+      if (dominates(other, candidate)) {
+        dominated = true;
+        break;
+      }
+    }
+    if (!dominated) {
+      print_result(candidate);
+    }
+  }
+
+  for (AVFrame *pFrame : frames) {
+    av_freep(&pFrame->data[0]);
+    av_frame_free(&pFrame);
+  }
+}
+
+int main(int argc, char **argv) {
+
+  av_register_all();
+  if (argc < 2) {
+    printf("usage: %s vid [max_frames]\n"
+           "Sweep encoder settings over a clip and report speed, size and quality.\n", argv[0]);
+    return -1;
+  }
+  int maxFrames = argc > 2 ? atoi(argv[2]) : DEFAULT_MAX_FRAMES;
+  sweep(argv[1], maxFrames);
+
+  return 0;
+}
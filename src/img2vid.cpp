@@ -3,6 +3,8 @@
 #include <iostream>
 #include <cstdint>
 
+#include "ImageHeader.h"
+#include "ImageLoader.h"
 #include "VideoDecoder.h"
 #include "VideoEncoder.h"
 
@@ -22,28 +24,17 @@ const AVCodecID CODEC_ID = AV_CODEC_ID_MPEG1VIDEO;
 
 using namespace video_syn;
 
-AVFrame *initFrame(int width, int height) {
-  AVFrame *pFrame = av_frame_alloc();
-  pFrame->format = AV_PIX_FMT_YUV420P;
-  pFrame->width = width;
-  pFrame->height = height;
-  int ret = av_image_alloc(pFrame->data,
-                           pFrame->linesize,
-                           pFrame->width,
-                           pFrame->height,
-                           AV_PIX_FMT_YUV420P,
-                           32);
-  if (ret < 0) {
-    throw std::runtime_error("could not allocate raw picture buffer");
-  }
-  return pFrame;
-}
-
 void video_encode(const char *imgFile) {
-  VideoDecoder decoder(imgFile);
-
-  int width = decoder.getWidth();
-  int height = decoder.getHeight();
+  int width, height;
+  ImageHeader header;
+  if (readImageHeader(imgFile, header)) {
+    width = header.width;
+    height = header.height;
+  } else {
+    VideoDecoder probe(imgFile);
+    width = probe.getWidth();
+    height = probe.getHeight();
+  }
 
   VideoEncoder::Config encoderConfig = {
     .width = width,
@@ -57,38 +48,17 @@ void video_encode(const char *imgFile) {
   };
   VideoEncoder encoder(OUTPUT_FILENAME, encoderConfig);
 
-  struct SwsContext *swsCtx;
-  swsCtx = sws_getContext(decoder.getWidth(),
-                          decoder.getHeight(),
-                          decoder.getPixelFormat(),
-                          width,
-                          height,
-                          AV_PIX_FMT_YUV420P,
-                          SWS_BILINEAR,
-                          nullptr,
-                          nullptr,
-                          nullptr);
-
-  AVFrame *pOutputFrame = initFrame(width, height);
-  AVFrame *pInputFrame = av_frame_alloc();
-  if (!decoder.nextFrame(pInputFrame)) {
-    throw std::runtime_error("Expect a frame from input, but got nothing");
-  }
-
+  AVFrame *pOutputFrame = loadImage(imgFile,
+                                    width,
+                                    height,
+                                    AV_PIX_FMT_YUV420P,
+                                    imageMemoryBudget());
   for (int i = 0; i < TOTAL_FRAMES; i++ ) {
-    sws_scale(swsCtx,
-              (uint8_t const * const *)pInputFrame->data,
-              pInputFrame->linesize,
-              0,
-              height,
-              pOutputFrame->data,
-              pOutputFrame->linesize);
     pOutputFrame->pts = i;
     encoder.encodeFrame(pOutputFrame);
   }
   encoder.finish();
 
-  av_free(pInputFrame);
   av_free(pOutputFrame);
 }
 
@@ -3,6 +3,7 @@
 #include <iostream>
 #include <cstdint>
 
+#include "ImageLoader.h"
 #include "VideoDecoder.h"
 #include "VideoEncoder.h"
 
@@ -23,56 +24,18 @@ const AVCodecID CODEC_ID = AV_CODEC_ID_MPEG1VIDEO;
 
 using namespace video_syn;
 
-AVFrame *initFrame(int width, int height) {
-  AVFrame *pFrame = av_frame_alloc();
-  pFrame->format = AV_PIX_FMT_YUV420P;
-  pFrame->width = width;
-  pFrame->height = height;
-  int ret = av_image_alloc(pFrame->data,
-                           pFrame->linesize,
-                           pFrame->width,
-                           pFrame->height,
-                           AV_PIX_FMT_YUV420P,
-                           32);
-  if (ret < 0) {
-    throw std::runtime_error("could not allocate raw picture buffer");
-  }
-  return pFrame;
-}
-
 int video_encode(const char *imgFile,
                  VideoEncoder &encoder,
                  int pts) {
-  VideoDecoder decoder(imgFile);
-  struct SwsContext *swsCtx;
-  swsCtx = sws_getContext(decoder.getWidth(),
-                          decoder.getHeight(),
-                          decoder.getPixelFormat(),
-                          WIDTH,
-                          HEIGHT,
-                          AV_PIX_FMT_YUV420P,
-                          SWS_BILINEAR,
-                          nullptr,
-                          nullptr,
-                          nullptr);
-
-  AVFrame *pOutputFrame = initFrame(WIDTH, HEIGHT);
-  AVFrame *pInputFrame = av_frame_alloc();
-  if (!decoder.nextFrame(pInputFrame)) {
-    throw std::runtime_error("Expect a frame from input, but got nothing");
-  }
+  AVFrame *pOutputFrame = loadImage(imgFile,
+                                    WIDTH,
+                                    HEIGHT,
+                                    AV_PIX_FMT_YUV420P,
+                                    imageMemoryBudget());
   for ( int i = 0; i < SECONDS_PER_PIC * FPS; i++ ) {
-    sws_scale(swsCtx,
-              (uint8_t const * const *)pInputFrame->data,
-              pInputFrame->linesize,
-              0,
-              decoder.getHeight(),
-              pOutputFrame->data,
-              pOutputFrame->linesize);
     pOutputFrame->pts = pts++;
     encoder.encodeFrame(pOutputFrame);
   }
-  av_free(pInputFrame);
   av_free(pOutputFrame);
   return pts;
 }
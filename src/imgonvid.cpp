@@ -2,7 +2,12 @@
 #include <cstdlib>
 #include <iostream>
 #include <cstdint>
+#include <memory>
+#include <string>
 
+#include "Checkpoint.h"
+#include "FrameFingerprint.h"
+#include "ImageLoader.h"
 #include "VideoDecoder.h"
 #include "VideoEncoder.h"
 
@@ -17,6 +22,9 @@ extern "C" {
 using namespace video_syn;
 
 const char *OUTPUT_FILENAME = "imgonvid.mpg";
+const char *CHECKPOINT_FILENAME = "imgonvid.mpg.ckpt";
+const int CHECKPOINT_INTERVAL = 250; // frames
+const double DEFAULT_REPEAT_THRESHOLD = -1; // off
 const AVCodecID CODEC_ID = AV_CODEC_ID_MPEG1VIDEO;
 const int FPS = 25;
 
@@ -37,37 +45,9 @@ AVFrame *initFrame(int width, int height, AVPixelFormat pixelFormat) {
   return pFrame;
 }
 
-AVFrame *getImageFrame(const char *filename, int width, int height) {
-  VideoDecoder decoder(filename);
-  AVFrame *srcFrame = av_frame_alloc();
-  if (!decoder.nextFrame(srcFrame)) {
-    throw std::runtime_error("no frame from the image");
-  }
-
-  AVFrame *dstFrame = initFrame(width, height, AV_PIX_FMT_RGB24);
-  struct SwsContext *swsCtx;
-  swsCtx = sws_getContext(decoder.getWidth(),
-                          decoder.getHeight(),
-                          decoder.getPixelFormat(),
-                          width,
-                          height,
-                          AV_PIX_FMT_RGB24,
-                          SWS_BILINEAR,
-                          nullptr,
-                          nullptr,
-                          nullptr);
-  sws_scale(swsCtx,
-            (uint8_t const * const *)srcFrame->data,
-            srcFrame->linesize,
-            0,
-            decoder.getHeight(),
-            dstFrame->data,
-            dstFrame->linesize);
-  av_free(srcFrame);
-  return dstFrame;
-}
-
-void encode(const char *imgFilename, const char *vidFilename) {
+void encode(const char *imgFilename,
+            const char *vidFilename,
+            double repeatThreshold) {
   VideoDecoder vidDecoder(vidFilename);
   int width = vidDecoder.getWidth();
   int height = vidDecoder.getHeight();
@@ -83,9 +63,23 @@ void encode(const char *imgFilename, const char *vidFilename) {
     .max_b_frames = 1,
     .codec_id = CODEC_ID,
   };
-  VideoEncoder encoder(OUTPUT_FILENAME, encoderConfig);
+  CheckpointFile checkpointFile(CHECKPOINT_FILENAME, CHECKPOINT_INTERVAL);
+  Checkpoint checkpoint;
+  std::string job = CheckpointFile::makeJob("imgonvid",
+                                            { imgFilename, vidFilename },
+                                            encoderConfig,
+                                            "repeat_threshold=" + std::to_string(repeatThreshold) +
+                                            " image_budget=" + std::to_string(imageMemoryBudget()));
+  std::unique_ptr<VideoEncoder> encoder;
+  if (checkpointFile.openEncoder(OUTPUT_FILENAME, encoderConfig, job, checkpoint, encoder)) {
+    vidDecoder.resume(checkpoint.input_timestamp, checkpoint.input_frames);
+  }
   AVFrame *pVidFrame = av_frame_alloc();
-  AVFrame *pImgFrame = getImageFrame(imgFilename, halfWidth, halfHeight);
+  AVFrame *pImgFrame = loadImage(imgFilename,
+                                 halfWidth,
+                                 halfHeight,
+                                 AV_PIX_FMT_RGB24,
+                                 imageMemoryBudget());
   AVFrame *pRGBFrame = initFrame(width, height, AV_PIX_FMT_RGB24);
   AVFrame *pYUVFrame = initFrame(width, height, AV_PIX_FMT_YUV420P);
 
@@ -112,36 +106,42 @@ void encode(const char *imgFilename, const char *vidFilename) {
                              nullptr,
                              nullptr);
 
-  int pts = 0;
+  int pts = checkpoint.pts;
+  RepeatDetector repeats(repeatThreshold);
   while (vidDecoder.nextFrame(pVidFrame)) {
-    sws_scale(swsRGBCtx,
-              (uint8_t const * const *)pVidFrame->data,
-              pVidFrame->linesize,
-              0,
-              height,
-              pRGBFrame->data,
-              pRGBFrame->linesize);
-    int ls1 = pRGBFrame->linesize[0];
-    int ls2 = pImgFrame->linesize[0];
-    for (int y = 0; y < halfHeight; y++) {
-      for (int x = 0; x < halfWidth; x++) {
-        for (int rgb = 0; rgb < 3; ++rgb) {
-          pRGBFrame->data[0][y * ls1 + x * 3 + rgb] =
-            pImgFrame->data[0][y * ls2 + x * 3 + rgb];
+    if (!repeats.isRepeat(pVidFrame)) {
+      sws_scale(swsRGBCtx,
+                (uint8_t const * const *)pVidFrame->data,
+                pVidFrame->linesize,
+                0,
+                height,
+                pRGBFrame->data,
+                pRGBFrame->linesize);
+      int ls1 = pRGBFrame->linesize[0];
+      int ls2 = pImgFrame->linesize[0];
+      for (int y = 0; y < halfHeight; y++) {
+        for (int x = 0; x < halfWidth; x++) {
+          for (int rgb = 0; rgb < 3; ++rgb) {
+            pRGBFrame->data[0][y * ls1 + x * 3 + rgb] =
+              pImgFrame->data[0][y * ls2 + x * 3 + rgb];
+          }
         }
       }
+      sws_scale(swsYUVCtx,
+                (uint8_t const * const *)pRGBFrame->data,
+                pRGBFrame->linesize,
+                0,
+                height,
+                pYUVFrame->data,
+                pYUVFrame->linesize);
     }
-    sws_scale(swsYUVCtx,
-              (uint8_t const * const *)pRGBFrame->data,
-              pRGBFrame->linesize,
-              0,
-              height,
-              pYUVFrame->data,
-              pYUVFrame->linesize);
     pYUVFrame->pts = pts++;
-    encoder.encodeFrame(pYUVFrame);
+    encoder->encodeFrame(pYUVFrame);
+    checkpointFile.frameDone(checkpoint, *encoder, vidDecoder, pts);
   }
-  encoder.finish();
+  printf("skipped compositing %d repeated frames\n", repeats.getRepeats());
+  encoder->finish();
+  checkpointFile.remove();
   av_free(pVidFrame);
   av_free(pImgFrame);
   av_free(pRGBFrame);
@@ -151,11 +151,14 @@ void encode(const char *imgFilename, const char *vidFilename) {
 int main(int argc, char **argv) {
   av_register_all();
   if (argc < 3) {
-    printf("usage: %s img vid\n"
-           "Example program to encode a video stream from image and video using libavcoded.\n", argv[0]);
+    printf("usage: %s img vid [repeat_threshold]\n"
+           "Example program to encode a video stream from image and video using libavcoded.\n"
+           "%s",
+           argv[0], RepeatDetector::USAGE);
     return -1;
   }
-  encode(argv[1], argv[2]);
+  double repeatThreshold = argc > 3 ? atof(argv[3]) : DEFAULT_REPEAT_THRESHOLD;
+  encode(argv[1], argv[2], repeatThreshold);
 
   return 0;
 }
@@ -2,7 +2,13 @@
 #include <cstdlib>
 #include <iostream>
 #include <cstdint>
+#include <memory>
+#include <string>
 
+#include "Checkpoint.h"
+#include "FrameFingerprint.h"
+#include "SegmentCache.h"
+#include "ImageLoader.h"
 #include "VideoDecoder.h"
 #include "VideoEncoder.h"
 
@@ -19,6 +25,10 @@ const int SECONDS_PER_PIC = 2;
 const int WIDTH = 640;
 const int HEIGHT = 480;
 const char *OUTPUT_FILENAME = "imgxvid.mpg";
+const char *INTRO_CACHE_DIR = "imgxvid_cache";
+const char *CHECKPOINT_FILENAME = "imgxvid.mpg.ckpt";
+const int CHECKPOINT_INTERVAL = 250; // frames
+const double DEFAULT_REPEAT_THRESHOLD = -1; // off
 const AVCodecID CODEC_ID = AV_CODEC_ID_MPEG1VIDEO;
 
 using namespace video_syn;
@@ -43,44 +53,26 @@ AVFrame *initFrame(int width, int height) {
 int encode_image(const char *imgFile,
                  VideoEncoder &encoder,
                  int pts) {
-  VideoDecoder decoder(imgFile);
-  struct SwsContext *swsCtx;
-  swsCtx = sws_getContext(decoder.getWidth(),
-                          decoder.getHeight(),
-                          decoder.getPixelFormat(),
-                          WIDTH,
-                          HEIGHT,
-                          AV_PIX_FMT_YUV420P,
-                          SWS_BILINEAR,
-                          nullptr,
-                          nullptr,
-                          nullptr);
-
-  AVFrame *pOutputFrame = initFrame(WIDTH, HEIGHT);
-  AVFrame *pInputFrame = av_frame_alloc();
-  if (!decoder.nextFrame(pInputFrame)) {
-    throw std::runtime_error("Expect a frame from input, but got nothing");
-  }
+  AVFrame *pOutputFrame = loadImage(imgFile,
+                                    WIDTH,
+                                    HEIGHT,
+                                    AV_PIX_FMT_YUV420P,
+                                    imageMemoryBudget());
   for ( int i = 0; i < SECONDS_PER_PIC * FPS; i++ ) {
-    sws_scale(swsCtx,
-              (uint8_t const * const *)pInputFrame->data,
-              pInputFrame->linesize,
-              0,
-              decoder.getHeight(),
-              pOutputFrame->data,
-              pOutputFrame->linesize);
     pOutputFrame->pts = pts++;
     encoder.encodeFrame(pOutputFrame);
   }
-  av_free(pInputFrame);
   av_free(pOutputFrame);
   return pts;
 }
 
 int encode_video(const char *vidFile,
                  VideoEncoder &encoder,
-                 int pts) {
+                 Checkpoint &checkpoint,
+                 CheckpointFile &checkpointFile,
+                 double repeatThreshold) {
   VideoDecoder decoder(vidFile);
+  RepeatDetector repeats(repeatThreshold);
   struct SwsContext *swsCtx;
   swsCtx = sws_getContext(decoder.getWidth(),
                           decoder.getHeight(),
@@ -95,24 +87,54 @@ int encode_video(const char *vidFile,
 
   AVFrame *pOutputFrame = initFrame(WIDTH, HEIGHT);
   AVFrame *pInputFrame = av_frame_alloc();
+  if (checkpoint.input_frames > 0) {
+    decoder.resume(checkpoint.input_timestamp, checkpoint.input_frames);
+  }
+  int pts = checkpoint.pts;
   while (decoder.nextFrame(pInputFrame)) {
-    sws_scale(swsCtx,
-              (uint8_t const * const *)pInputFrame->data,
-              pInputFrame->linesize,
-              0,
-              decoder.getHeight(),
-              pOutputFrame->data,
-              pOutputFrame->linesize);
+    if (!repeats.isRepeat(pInputFrame)) {
+      sws_scale(swsCtx,
+                (uint8_t const * const *)pInputFrame->data,
+                pInputFrame->linesize,
+                0,
+                decoder.getHeight(),
+                pOutputFrame->data,
+                pOutputFrame->linesize);
+    }
     // TODO what if pts is not increamental from the video source
     pOutputFrame->pts = pts++;
     encoder.encodeFrame(pOutputFrame);
+    checkpointFile.frameDone(checkpoint, encoder, decoder, pts);
   }
+  printf("skipped scaling %d repeated frames\n", repeats.getRepeats());
   av_free(pInputFrame);
   av_free(pOutputFrame);
   return pts;
 }
 
-void encode(const char *imgFilename, const char *vidFilename) {
+// Encodes the intro into its own closed-GOP segment, or reuses a cached one,
+// and splices it into the output. Returns the pts following the intro.
+int splice_image(const char *imgFile,
+                 VideoEncoder &encoder,
+                 const VideoEncoder::Config &config) {
+  VideoEncoder::Config introConfig = config;
+  introConfig.closed_gop = true;
+  const int frames = SECONDS_PER_PIC * FPS;
+
+  SegmentCache cache(INTRO_CACHE_DIR);
+  std::string key = SegmentCache::makeKey(imgFile, introConfig, frames, imageMemoryBudget());
+  std::string segment = cache.get(key, [&](const char *segmentFile) {
+      VideoEncoder introEncoder(segmentFile, introConfig);
+      encode_image(imgFile, introEncoder, 0);
+      introEncoder.finishSegment();
+    });
+  encoder.appendSegment(segment.c_str());
+  return frames;
+}
+
+void encode(const char *imgFilename,
+            const char *vidFilename,
+            double repeatThreshold) {
   VideoEncoder::Config encoderConfig = {
     .width = WIDTH,
     .height = HEIGHT,
@@ -123,21 +145,36 @@ void encode(const char *imgFilename, const char *vidFilename) {
     .max_b_frames = 1,
     .codec_id = CODEC_ID,
   };
-  VideoEncoder encoder(OUTPUT_FILENAME, encoderConfig);
-  int pts = encode_image(imgFilename, encoder, 0);
-  encode_video(vidFilename, encoder, pts);
-  encoder.finish();
+  CheckpointFile checkpointFile(CHECKPOINT_FILENAME, CHECKPOINT_INTERVAL);
+  Checkpoint checkpoint;
+  std::string job = CheckpointFile::makeJob("imgxvid",
+                                            { imgFilename, vidFilename },
+                                            encoderConfig,
+                                            "repeat_threshold=" + std::to_string(repeatThreshold) +
+                                            " image_budget=" + std::to_string(imageMemoryBudget()));
+  std::unique_ptr<VideoEncoder> encoder;
+  if (!checkpointFile.openEncoder(OUTPUT_FILENAME, encoderConfig, job, checkpoint, encoder)) {
+    int pts = splice_image(imgFilename, *encoder, encoderConfig);
+    checkpoint = { job, AV_NOPTS_VALUE, 0, encoder->checkpoint(), pts };
+    checkpointFile.save(checkpoint);
+  }
+  encode_video(vidFilename, *encoder, checkpoint, checkpointFile, repeatThreshold);
+  encoder->finish();
+  checkpointFile.remove();
 }
 
 int main(int argc, char **argv) {
 
   av_register_all();
   if (argc < 3) {
-    printf("usage: %s img vid\n"
-           "Example program to encode a video stream from image and video using libavcoded.\n", argv[0]);
+    printf("usage: %s img vid [repeat_threshold]\n"
+           "Example program to encode a video stream from image and video using libavcoded.\n"
+           "%s",
+           argv[0], RepeatDetector::USAGE);
     return -1;
   }
-  encode(argv[1], argv[2]);
+  double repeatThreshold = argc > 3 ? atof(argv[3]) : DEFAULT_REPEAT_THRESHOLD;
+  encode(argv[1], argv[2], repeatThreshold);
 
   return 0;
 }